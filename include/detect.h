@@ -2,6 +2,7 @@
 #include "./utils.h"
 #include "llama.h"
 
+#include <string_view>
 #include <vector>
 
 struct TokenStats {
@@ -12,8 +13,19 @@ struct TokenStats {
 
 TokenStats compute_token_stats(int vocab_size, int token_id, const float * logits, std::vector<double> & buffer);
 
+// Log likelihood from the scoring model, mean and variance of the scoring log probabilities
+// taken under the reference (sampling) model distribution
+TokenStats compute_token_stats_pair(int                   vocab_size,
+                                    int                   token_id,
+                                    const float *         ref_logits,
+                                    const float *         score_logits,
+                                    std::vector<double> & buffer);
+
 double compute_discrepancy(const std::vector<float *> &     all_logits,
                            const std::vector<llama_token> & tokens,
                            int                              vocab_size);
 
-double analyze_text(const LlamaState & llama, const std::string & text, int n_ctx);
+double analyze_text(const LlamaState & llama, std::string_view text, int n_ctx);
+
+// Two-model mode: both models decode the same micro-batches concurrently on their own contexts
+double analyze_text_pair(const LlamaState & reference, const LlamaState & scoring, std::string_view text, int n_ctx);
@@ -1,13 +1,14 @@
 #pragma once
 #include <arrow/api.h>
+#include <arrow/compute/cast.h>
 #include <arrow/csv/api.h>
 #include <parquet/arrow/reader.h>
 
-bool read_file_to_string(const std::string & path, std::string & out);
+#include <iostream>
+#include <string_view>
+#include <type_traits>
 
-std::pair<std::shared_ptr<arrow::Table>, std::vector<std::string>> load_parquet_and_get_text(
-    const std::string & path,
-    const std::string & col_name);
+bool read_file_to_string(const std::string & path, std::string & out);
 
 std::shared_ptr<arrow::Table> load_parquet_table(const std::string & path);
 
@@ -15,41 +16,141 @@ bool save_parquet_with_scores(const std::string &           out_path,
                               std::shared_ptr<arrow::Table> table,
                               const std::vector<double> &   scores);
 
-template <typename T> std::vector<T> extract_column_as(std::shared_ptr<arrow::Table> table, const std::string & name) {
-    std::vector<T> values;
-    if (!table) {
-        return values;
+// Calls fn(row, value, valid), fn may return false to stop the iteration early
+template <typename Fn, typename V> bool invoke_row(Fn & fn, const int64_t row, const V value, const bool valid) {
+    if constexpr (std::is_void_v<std::invoke_result_t<Fn &, int64_t, V, bool>>) {
+        fn(row, value, valid);
+        return true;
+    } else {
+        return fn(row, value, valid);
     }
+}
 
-    auto col = table->GetColumnByName(name);
-    if (!col) {
-        return values;
-    }
+// Maps a C++ value type to the Arrow arrays a ColumnView reads without conversion
+template <typename T> struct ColumnTraits {
+    using ArrowType = typename arrow::CTypeTraits<T>::ArrowType;
+    using ArrayType = typename arrow::TypeTraits<ArrowType>::ArrayType;
+
+    static bool is_native(const arrow::DataType & type) { return type.id() == ArrowType::type_id; }
+
+    static std::shared_ptr<arrow::DataType> target_type() { return arrow::TypeTraits<ArrowType>::type_singleton(); }
 
-    for (int i = 0; i < col->num_chunks(); i++) {
-        auto array = col->chunk(i);
+    template <typename Fn> static bool visit(const arrow::Array & chunk, const int64_t offset, Fn & fn) {
+        const auto & array  = static_cast<const ArrayType &>(chunk);
+        const T *    values = array.raw_values();
 
-        if (array->type_id() == arrow::Type::DOUBLE) {
-            auto data = std::static_pointer_cast<arrow::DoubleArray>(array);
-            for (int64_t j = 0; j < data->length(); j++) {
-                values.push_back(static_cast<T>(data->Value(j)));
+        if (array.null_count() == 0) {
+            for (int64_t j = 0; j < array.length(); j++) {
+                if (!invoke_row(fn, offset + j, values[j], true)) {
+                    return false;
+                }
             }
-        } else if (array->type_id() == arrow::Type::FLOAT) {
-            auto data = std::static_pointer_cast<arrow::FloatArray>(array);
-            for (int64_t j = 0; j < data->length(); j++) {
-                values.push_back(static_cast<T>(data->Value(j)));
+        } else {
+            for (int64_t j = 0; j < array.length(); j++) {
+                if (!invoke_row(fn, offset + j, values[j], array.IsValid(j))) {
+                    return false;
+                }
             }
-        } else if (array->type_id() == arrow::Type::INT64) {
-            auto data = std::static_pointer_cast<arrow::Int64Array>(array);
-            for (int64_t j = 0; j < data->length(); j++) {
-                values.push_back(static_cast<T>(data->Value(j)));
+        }
+        return true;
+    }
+};
+
+template <> struct ColumnTraits<std::string_view> {
+    static bool is_native(const arrow::DataType & type) {
+        return type.id() == arrow::Type::STRING || type.id() == arrow::Type::LARGE_STRING;
+    }
+
+    static std::shared_ptr<arrow::DataType> target_type() { return arrow::large_utf8(); }
+
+    template <typename Fn> static bool visit(const arrow::Array & chunk, const int64_t offset, Fn & fn) {
+        if (chunk.type_id() == arrow::Type::STRING) {
+            return visit_strings(static_cast<const arrow::StringArray &>(chunk), offset, fn);
+        }
+        return visit_strings(static_cast<const arrow::LargeStringArray &>(chunk), offset, fn);
+    }
+
+    template <typename ArrayType, typename Fn>
+    static bool visit_strings(const ArrayType & array, const int64_t offset, Fn & fn) {
+        for (int64_t j = 0; j < array.length(); j++) {
+            // null slots are reported as empty views
+            const bool valid = array.IsValid(j);
+            if (!invoke_row(fn, offset + j, valid ? array.GetView(j) : std::string_view(), valid)) {
+                return false;
             }
-        } else if (array->type_id() == arrow::Type::INT32) {
-            auto data = std::static_pointer_cast<arrow::Int32Array>(array);
-            for (int64_t j = 0; j < data->length(); j++) {
-                values.push_back(static_cast<T>(data->Value(j)));
+        }
+        return true;
+    }
+};
+
+// Read-only typed view over the chunks of a table column, values are never copied.
+// Null rows are reported explicitly, so row indices always match the table.
+template <typename T> class ColumnView {
+  public:
+    ColumnView() = default;
+
+    explicit ColumnView(std::shared_ptr<arrow::ChunkedArray> column) : column_(std::move(column)) {}
+
+    int64_t length() const { return column_ ? column_->length() : 0; }
+
+    int64_t null_count() const { return column_ ? column_->null_count() : 0; }
+
+    bool empty() const { return length() == 0; }
+
+    // Calls fn(row, value, valid) for every row, value is unspecified when valid is false.
+    // Iteration stops early if fn returns false
+    template <typename Fn> void for_each(Fn && fn) const {
+        if (!column_) {
+            return;
+        }
+        int64_t offset = 0;
+        for (const auto & chunk : column_->chunks()) {
+            if (!ColumnTraits<T>::visit(*chunk, offset, fn)) {
+                return;
             }
+            offset += chunk->length();
+        }
+    }
+
+  private:
+    std::shared_ptr<arrow::ChunkedArray> column_;
+};
+
+// Columns already stored as T are wrapped as is, any other type (dictionary, boolean,
+// narrower integers, ...) is converted once with an Arrow cast; failed casts are reported
+template <typename T>
+bool make_column_view(const std::shared_ptr<arrow::Table> & table, const std::string & name, ColumnView<T> & view) {
+    if (!table) {
+        std::cerr << "Error: Input table is null." << std::endl;
+        return false;
+    }
+
+    auto col = table->GetColumnByName(name);
+    if (!col) {
+        std::cerr << "Column '" << name << "' not found in Parquet!" << std::endl;
+        return false;
+    }
+
+    if (!ColumnTraits<T>::is_native(*col->type())) {
+        auto result = arrow::compute::Cast(arrow::Datum(col), ColumnTraits<T>::target_type());
+        if (!result.ok()) {
+            std::cerr << "Error converting column '" << name << "' from " << col->type()->ToString() << ": "
+                      << result.status().ToString() << std::endl;
+            return false;
         }
+        col = result->chunked_array();
     }
-    return values;
+
+    view = ColumnView<T>(std::move(col));
+    return true;
 }
+
+// Parquet table and a view of its text column. Texts are read in place from the table, or from the
+// converted copy owned by the view when the column is not string/large_string (dictionary, binary, ...),
+// so string_views taken from texts are valid only while this struct, or a copy of texts, is alive
+struct ParquetTexts {
+    std::shared_ptr<arrow::Table> table;
+    ColumnView<std::string_view>  texts;
+};
+
+ParquetTexts load_parquet_and_get_text(const std::string & path, const std::string & col_name);
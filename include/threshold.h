@@ -4,7 +4,10 @@
 #include <arrow/csv/api.h>
 #include <parquet/arrow/reader.h>
 
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <vector>
 
 struct ThresholdResult {
     double threshold;
@@ -15,7 +18,61 @@ struct ThresholdResult {
     bool   is_lower_better;
 };
 
-ThresholdResult find_optimal_threshold(std::shared_ptr<arrow::Table> table,
-                                       const std::string &           score_col,
-                                       const std::string &           label_col,
-                                       double                        beta);
+// One operating point of the ROC / PR curves
+struct CurvePoint {
+    double threshold;
+    double fpr;
+    double tpr;  // equal to recall
+    double precision;
+};
+
+struct ConfidenceInterval {
+    double lower;
+    double upper;
+};
+
+// Metrics for a single decision direction
+// lower is better:  score <= threshold => AI
+// higher is better: score >= threshold => AI
+struct DirectionReport {
+    ThresholdResult         best;
+    double                  roc_auc;
+    double                  pr_auc;  // average precision
+    std::vector<CurvePoint> curve;
+};
+
+struct ColumnEvaluation {
+    std::string     score_col;
+    int64_t         n_rows;
+    int64_t         n_ai;
+    DirectionReport lower;
+    DirectionReport higher;
+
+    // Percentile bootstrap intervals for the best direction, valid only when n_bootstrap > 0
+    int                n_bootstrap;
+    ConfidenceInterval threshold_ci;
+    ConfidenceInterval f_score_ci;
+    ConfidenceInterval roc_auc_ci;
+
+    const DirectionReport & best_direction() const { return lower.best.f_score >= higher.best.f_score ? lower : higher; }
+};
+
+struct EvaluationOptions {
+    double   beta             = 1.0;
+    int      n_bootstrap      = 0;
+    double   confidence       = 0.95;
+    int      n_threads        = 0;  // 0 = hardware concurrency
+    uint64_t seed             = 42;
+    size_t   max_curve_points = 1000;
+};
+
+// Sort each score column once and sweep it in both directions,
+// optionally followed by parallel bootstrap resamples of the sorted data
+std::vector<ColumnEvaluation> evaluate_score_columns(std::shared_ptr<arrow::Table>    table,
+                                                     const std::vector<std::string> & score_cols,
+                                                     const std::string &              label_col,
+                                                     const EvaluationOptions &        options);
+
+bool save_evaluation_report(const std::string &                   out_path,
+                            const std::vector<ColumnEvaluation> & evaluations,
+                            const EvaluationOptions &             options);
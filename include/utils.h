@@ -1,6 +1,7 @@
 #pragma once
 #include "llama.h"
 
+#include <atomic>
 #include <filesystem>
 #include <string>
 
@@ -12,7 +13,18 @@ struct LlamaState {
     llama_context *     ctx   = nullptr;
 };
 
-bool setup_llama(LlamaState & llama, const std::string & model_path, bool gpu, int n_ctx, int n_batch);
+// n_threads <= 0 keeps the llama.cpp default
+bool setup_llama(LlamaState &        llama,
+                 const std::string & model_path,
+                 bool                gpu,
+                 int                 n_ctx,
+                 int                 n_batch,
+                 int                 n_threads = 0);
+
+void free_llama(LlamaState & llama);
+
+// Two models can share token ids only if their vocabularies are identical
+bool vocabs_match(const llama_vocab * a, const llama_vocab * b);
 
 // Custom logging callback that only print errors
 void custom_log(ggml_log_level level, const char * text, void * user_data);
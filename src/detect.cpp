@@ -1,38 +1,124 @@
 #include "../include/detect.h"
 
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Helper thread that runs one task at a time, handed over with post() and awaited with wait()
+class TaskWorker {
+  public:
+    TaskWorker() : thread_([this] { run(); }) {}
+
+    ~TaskWorker() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex_);
+            task_ = std::move(task);
+        }
+        cv_.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return !task_; });
+    }
+
+  private:
+    void run() {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return stop_ || task_; });
+            if (!task_) {
+                return;
+            }
+
+            lock.unlock();
+            task_();
+            lock.lock();
+
+            task_ = nullptr;
+            cv_.notify_all();
+        }
+    }
+
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    std::function<void()>   task_;
+    bool                    stop_ = false;
+    std::thread             thread_;  // last member, started once the state above is initialized
+};
+
+}  // namespace
 
 TokenStats compute_token_stats(const int             vocab_size,
                                const int             token_id,
                                const float *         logits,
                                std::vector<double> & buffer) {
-    float max_logit = -1e9;
+    // single model: the same distribution is used for sampling and scoring
+    return compute_token_stats_pair(vocab_size, token_id, logits, logits, buffer);
+}
+
+TokenStats compute_token_stats_pair(const int             vocab_size,
+                                    const int             token_id,
+                                    const float *         ref_logits,
+                                    const float *         score_logits,
+                                    std::vector<double> & buffer) {
+    const bool same_model = ref_logits == score_logits;
+
+    float max_ref = -1e9;
     for (int i = 0; i < vocab_size; i++) {
-        if (logits[i] > max_logit) {
-            max_logit = logits[i];
-        }
+        max_ref = std::max(max_ref, ref_logits[i]);
     }
 
-    double sum_exp = 0.0;
+    double sum_exp_ref = 0.0;
     for (int i = 0; i < vocab_size; i++) {
-        buffer[i] = std::exp(logits[i] - max_logit);
-        sum_exp += buffer[i];
+        buffer[i] = std::exp(ref_logits[i] - max_ref);
+        sum_exp_ref += buffer[i];
+    }
+
+    // with a single model the scoring softmax is the reference one, skip the second pass
+    float  max_score     = max_ref;
+    double sum_exp_score = sum_exp_ref;
+    if (!same_model) {
+        max_score = -1e9;
+        for (int i = 0; i < vocab_size; i++) {
+            max_score = std::max(max_score, score_logits[i]);
+        }
+
+        sum_exp_score = 0.0;
+        for (int i = 0; i < vocab_size; i++) {
+            sum_exp_score += std::exp(score_logits[i] - max_score);
+        }
     }
-    double log_sum_exp = std::log(sum_exp);
+    const double log_sum_exp_score = std::log(sum_exp_score);
 
     TokenStats stats = { 0.0, 0.0, 0.0 };
 
     if (token_id >= 0 && token_id < vocab_size) {
-        stats.log_likelihood = (logits[token_id] - max_logit) - log_sum_exp;
+        stats.log_likelihood = (score_logits[token_id] - max_score) - log_sum_exp_score;
     }
 
+    // expectation of the scoring log probabilities under the reference distribution
     double mean            = 0.0;  // E[X]
     double expected_square = 0.0;  // E[X^2]
 
     for (int i = 0; i < vocab_size; i++) {
-        double p  = buffer[i] / sum_exp;
-        double lp = (logits[i] - max_logit) - log_sum_exp;
+        double p  = buffer[i] / sum_exp_ref;
+        double lp = (score_logits[i] - max_score) - log_sum_exp_score;
 
         mean += p * lp;
         expected_square += p * (lp * lp);
@@ -73,33 +159,45 @@ double compute_discrepancy(const std::vector<float *> &     all_logits,
     return (sum_ll - sum_mean) / std::sqrt(sum_var);
 }
 
-double analyze_text(const LlamaState & llama, const std::string & text, const int n_ctx) {
-    // clear cache
-    const auto memory = llama_get_memory(llama.ctx);
-    llama_memory_seq_rm(memory, -1, -1, -1);
-
+static bool tokenize_text(const llama_vocab *        vocab,
+                          const std::string_view     text,
+                          const int                  n_ctx,
+                          std::vector<llama_token> & tokens) {
     // Input text tokenized
     // size: input text length + 2 for BOS and EOS
-    std::vector<llama_token> tokens(text.length() + 2);
-    int n_tokens = llama_tokenize(llama.vocab, text.c_str(), static_cast<int>(text.length()), tokens.data(),
+    tokens.resize(text.length() + 2);
+    int n_tokens = llama_tokenize(vocab, text.data(), static_cast<int>(text.length()), tokens.data(),
                                   static_cast<int>(tokens.size()), true, false);
 
     if (n_tokens < 0) {
         tokens.resize(-n_tokens);
-        n_tokens = llama_tokenize(llama.vocab, text.c_str(), static_cast<int>(text.length()), tokens.data(),
+        n_tokens = llama_tokenize(vocab, text.data(), static_cast<int>(text.length()), tokens.data(),
                                   static_cast<int>(tokens.size()), true, false);
     }
     tokens.resize(n_tokens);
 
     if (n_tokens < 2) {
         std::cerr << "Not enough tokens provided (minimum 2 tokens)" << std::endl;
-        return 1;
+        return false;
     }
 
     if (n_tokens > n_ctx) {
         std::cerr << "Too many tokens provided: " << n_tokens << " (maximum " << n_ctx << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+double analyze_text(const LlamaState & llama, const std::string_view text, const int n_ctx) {
+    // clear cache
+    const auto memory = llama_get_memory(llama.ctx);
+    llama_memory_seq_rm(memory, -1, -1, -1);
+
+    std::vector<llama_token> tokens;
+    if (!tokenize_text(llama.vocab, text, n_ctx, tokens)) {
         return 1;
     }
+    const int n_tokens = static_cast<int>(tokens.size());
 
     auto batch = llama_batch_init(n_tokens, 0, 1);
     for (int i = 0; i < n_tokens; i++) {
@@ -131,3 +229,101 @@ double analyze_text(const LlamaState & llama, const std::string & text, const in
     llama_batch_free(batch);
     return score;
 }
+
+double analyze_text_pair(const LlamaState &     reference,
+                         const LlamaState &     scoring,
+                         const std::string_view text,
+                         const int              n_ctx) {
+    // clear cache of both models
+    llama_memory_seq_rm(llama_get_memory(reference.ctx), -1, -1, -1);
+    llama_memory_seq_rm(llama_get_memory(scoring.ctx), -1, -1, -1);
+
+    // vocabularies are checked to match at load time, so the token ids are valid for both models
+    std::vector<llama_token> tokens;
+    if (!tokenize_text(scoring.vocab, text, n_ctx, tokens)) {
+        return 1;
+    }
+
+    // the last token is only ever a target, it does not need to be decoded
+    const int steps      = static_cast<int>(tokens.size()) - 1;
+    const int n_ubatch   = static_cast<int>(std::min(llama_n_ubatch(reference.ctx), llama_n_ubatch(scoring.ctx)));
+    const int vocab_size = llama_vocab_n_tokens(scoring.vocab);
+
+    std::cout << "Running inference on " << tokens.size() << " tokens (reference + scoring)" << std::endl;
+
+    TokenStats sum = { 0.0, 0.0, 0.0 };
+
+    std::vector<double>        buffer(vocab_size);
+    std::vector<double>        worker_buffer(vocab_size);
+    std::vector<const float *> ref_logits(n_ubatch);
+    std::vector<const float *> score_logits(n_ubatch);
+
+    // statistics of positions [from, to) of the micro-batch starting at token start
+    auto accumulate = [&](const int start, const int from, const int to, std::vector<double> & buf) {
+        TokenStats partial = { 0.0, 0.0, 0.0 };
+        for (int i = from; i < to; i++) {
+            auto [log_likelihood, mean, variance] =
+                compute_token_stats_pair(vocab_size, tokens[start + i + 1], ref_logits[i], score_logits[i], buf);
+
+            partial.log_likelihood += log_likelihood;
+            partial.mean += mean;
+            partial.variance += variance;
+        }
+        return partial;
+    };
+
+    // A single helper thread, alive for the whole text, runs the reference decode while this thread decodes
+    // the scoring model. The statistics pass can not overlap the next decode, which overwrites the logits,
+    // so it is split between both threads while the contexts are idle instead
+    TaskWorker worker;
+
+    // decode one micro-batch on both models at a time, logits are consumed before the next decode overwrites them
+    auto batch = llama_batch_init(n_ubatch, 0, 1);
+    for (int start = 0; start < steps; start += n_ubatch) {
+        const int n_batch_tokens = std::min(n_ubatch, steps - start);
+
+        batch.n_tokens = n_batch_tokens;
+        for (int i = 0; i < n_batch_tokens; i++) {
+            batch.token[i]     = tokens[start + i];
+            batch.pos[i]       = start + i;
+            batch.n_seq_id[i]  = 1;
+            batch.seq_id[i][0] = 0;
+            batch.logits[i]    = true;
+        }
+
+        // each context runs on its own thread set, the batch is only read
+        int ref_status = 0;
+        worker.post([&] { ref_status = llama_decode(reference.ctx, batch); });
+        const int score_status = llama_decode(scoring.ctx, batch);
+        worker.wait();
+
+        if (ref_status != 0 || score_status != 0) {
+            std::cerr << "Inference failed" << std::endl;
+            llama_batch_free(batch);
+            return 0.0;
+        }
+
+        // fetch the logits here, the split below only reads them and never touches the contexts
+        for (int i = 0; i < n_batch_tokens; i++) {
+            ref_logits[i]   = llama_get_logits_ith(reference.ctx, i);
+            score_logits[i] = llama_get_logits_ith(scoring.ctx, i);
+        }
+
+        const int  half       = n_batch_tokens / 2;
+        TokenStats worker_sum = { 0.0, 0.0, 0.0 };
+        worker.post([&] { worker_sum = accumulate(start, half, n_batch_tokens, worker_buffer); });
+        const TokenStats own_sum = accumulate(start, 0, half, buffer);
+        worker.wait();
+
+        sum.log_likelihood += own_sum.log_likelihood + worker_sum.log_likelihood;
+        sum.mean += own_sum.mean + worker_sum.mean;
+        sum.variance += own_sum.variance + worker_sum.variance;
+    }
+    llama_batch_free(batch);
+
+    if (sum.variance <= 1e-9) {
+        return 0.0;
+    }
+
+    return (sum.log_likelihood - sum.mean) / std::sqrt(sum.variance);
+}
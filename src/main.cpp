@@ -3,6 +3,7 @@
 #include "../include/threshold.h"
 #include "../include/utils.h"
 
+#include <algorithm>
 #include <argparse/argparse.hpp>
 #include <atomic>
 #include <csignal>
@@ -19,6 +20,9 @@ int main(const int argc, char * argv[]) {
     program.add_argument("-m", "--model")
         .help("Path to the GGUF model file")
         .default_value("../models/tiiuae-falcon-7b-instruct-Q5_K_M.gguf");
+    program.add_argument("--ref-model")
+        .help("Path to a GGUF reference (sampling) model sharing the tokenizer, enables two-model mode")
+        .default_value(std::string(""));
     program.add_argument("-f", "--file").help("Path to the input file (txt or parquet)").required();
     program.add_argument("-c", "--ctx").help("Size of the prompt context").default_value(4096).scan<'i', int>();
     program.add_argument("-b", "--batch").help("Logical max batch size").default_value(4096).scan<'i', int>();
@@ -37,6 +41,26 @@ int main(const int argc, char * argv[]) {
         .help("Beta value for F-score optimization (ex 0.5 = prioritize precision, 2.0 = prioritize recall)")
         .default_value(1.0)
         .scan<'g', double>();
+    program.add_argument("--score-col")
+        .help("Score column(s) to evaluate in threshold mode")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .default_value(std::vector<std::string>{ "discrepancy" });
+    program.add_argument("--bootstrap")
+        .help("Number of bootstrap resamples for threshold confidence intervals (0 = disabled)")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--confidence")
+        .help("Confidence level of the bootstrap intervals")
+        .default_value(0.95)
+        .scan<'g', double>();
+    program.add_argument("--threads")
+        .help("CPU threads for inference, split evenly between the models in two-model mode, and for bootstrap "
+              "(0 = llama.cpp default per model context, all cores for bootstrap)")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--report")
+        .help("Write ROC/PR curves and metrics to a JSON report (threshold mode only)")
+        .default_value(std::string(""));
 
     try {
         program.parse_args(argc, argv);
@@ -46,9 +70,20 @@ int main(const int argc, char * argv[]) {
         return 1;
     }
 
+    if (program.get<int>("--bootstrap") < 0) {
+        std::cerr << "--bootstrap must be a non-negative number of resamples" << std::endl;
+        return 1;
+    }
+
+    if (const double confidence = program.get<double>("--confidence"); !(confidence > 0.0 && confidence < 1.0)) {
+        std::cerr << "--confidence must be between 0 and 1 (ex 0.95), got " << confidence << std::endl;
+        return 1;
+    }
+
     const bool   verbose     = program.get<bool>("--verbose");
     const bool   gpu         = program.get<bool>("--gpu");
     const auto   model_path  = program.get<std::string>("--model");
+    const auto   ref_path    = program.get<std::string>("--ref-model");
     const auto   input_file  = program.get<std::string>("--file");
     const auto   col_name    = program.get<std::string>("--col");
     const auto   output_file = program.get<std::string>("--output");
@@ -57,6 +92,9 @@ int main(const int argc, char * argv[]) {
     const bool   find_mode   = program.get<bool>("--find-threshold");
     const auto   label_col   = program.get<std::string>("--label-col");
     const double beta        = program.get<double>("--beta");
+    const auto   score_cols  = program.get<std::vector<std::string>>("--score-col");
+    const auto   report_file = program.get<std::string>("--report");
+    const int    n_threads   = program.get<int>("--threads");
 
     if (find_mode) {
         std::cout << "Running in Threshold Optimization Mode!" << std::endl;
@@ -67,22 +105,54 @@ int main(const int argc, char * argv[]) {
             return 1;
         }
 
+        EvaluationOptions options;
+        options.beta        = beta;
+        options.n_bootstrap = program.get<int>("--bootstrap");
+        options.confidence  = program.get<double>("--confidence");
+        options.n_threads   = n_threads;
+
         std::cout << "Finding optimal threshold optimizing F-Beta Score" << std::endl;
 
-        ThresholdResult res = find_optimal_threshold(table, "discrepancy", label_col, beta);
+        const auto evaluations = evaluate_score_columns(table, score_cols, label_col, options);
 
-        if (res.f_score == 0.0) {
+        if (evaluations.empty()) {
             std::cerr << "Failed to find a valid threshold" << std::endl;
-        } else {
-            std::cout << "\n---- RESULTS ----" << std::endl;
+            return 1;
+        }
+
+        for (const auto & eval : evaluations) {
+            const auto & best = eval.best_direction();
+            const auto & res  = best.best;
+
+            std::cout << "\n---- RESULTS: " << eval.score_col << " ----" << std::endl;
+            std::cout << "Rows:              " << eval.n_rows << " (" << eval.n_ai << " AI)" << std::endl;
             std::cout << "Optimal Threshold: " << res.threshold << std::endl;
             std::cout << "Max F-Beta Score:  " << res.f_score << std::endl;
             std::cout << "Precision:         " << res.precision << std::endl;
             std::cout << "Recall:            " << res.recall << std::endl;
+            std::cout << "Accuracy:          " << res.accuracy << std::endl;
+            std::cout << "ROC AUC:           " << best.roc_auc << std::endl;
+            std::cout << "PR AUC:            " << best.pr_auc << std::endl;
             std::cout << "Direction:         "
-                      << (res.is_lower_better ? "Score < Threshold => AI" : "Score > Threshold => AI") << std::endl;
+                      << (res.is_lower_better ? "Score <= Threshold => AI" : "Score >= Threshold => AI") << std::endl;
+            if (eval.n_bootstrap > 0) {
+                std::cout << "Threshold CI:      [" << eval.threshold_ci.lower << ", " << eval.threshold_ci.upper
+                          << "]" << std::endl;
+                std::cout << "F-Beta CI:         [" << eval.f_score_ci.lower << ", " << eval.f_score_ci.upper << "]"
+                          << std::endl;
+                std::cout << "ROC AUC CI:        [" << eval.roc_auc_ci.lower << ", " << eval.roc_auc_ci.upper << "]"
+                          << std::endl;
+            }
             std::cout << "-----------------" << std::endl;
         }
+
+        if (!report_file.empty()) {
+            if (save_evaluation_report(report_file, evaluations, options)) {
+                std::cout << "Report saved to: " << report_file << std::endl;
+            } else {
+                std::cerr << "Failed to save report." << std::endl;
+            }
+        }
         return 0;
     }
 
@@ -99,41 +169,76 @@ int main(const int argc, char * argv[]) {
 
     llama_backend_init();
 
+    const bool two_models = !ref_path.empty();
+
+    // both contexts decode at the same time in two-model mode, so an explicit budget is split between them.
+    // 0 keeps the llama.cpp default for every context in both modes
+    const int model_threads = two_models && n_threads > 0 ? std::max(1, n_threads / 2) : n_threads;
+
     LlamaState llama = {};
-    if (!setup_llama(llama, model_path, gpu, n_ctx, n_batch)) {
+    if (!setup_llama(llama, model_path, gpu, n_ctx, n_batch, model_threads)) {
         std::cerr << "Failed to load model from " << model_path << std::endl;
+        free_llama(llama);
+        llama_backend_free();
         return 1;
     }
 
+    LlamaState reference = {};
+    if (two_models) {
+        std::cout << "Loading reference model..." << std::endl;
+
+        if (!setup_llama(reference, ref_path, gpu, n_ctx, n_batch, model_threads)) {
+            std::cerr << "Failed to load reference model from " << ref_path << std::endl;
+            free_llama(reference);
+            free_llama(llama);
+            llama_backend_free();
+            return 1;
+        }
+
+        if (!vocabs_match(reference.vocab, llama.vocab)) {
+            std::cerr << "Reference and scoring models must share the same vocabulary" << std::endl;
+            free_llama(reference);
+            free_llama(llama);
+            llama_backend_free();
+            return 1;
+        }
+    }
+
+    auto analyze = [&](const std::string_view text) {
+        return two_models ? analyze_text_pair(reference, llama, text, n_ctx) : analyze_text(llama, text, n_ctx);
+    };
+
     if (input_file.ends_with(".parquet")) {
         std::cout << "Detected Parquet file. Reading column: '" << col_name << "'" << std::endl;
         auto [table, texts] = load_parquet_and_get_text(input_file, col_name);
 
         if (!table || texts.empty()) {
             std::cerr << "Failed to load Parquet or column is empty." << std::endl;
-            llama_free(llama.ctx);
-            llama_model_free(llama.model);
+            free_llama(reference);
+            free_llama(llama);
             llama_backend_free();
             return 1;
         }
 
-        std::cout << "Loaded " << texts.size() << " rows. Inference started!" << std::endl;
+        std::cout << "Loaded " << texts.length() << " rows. Inference started!" << std::endl;
         std::vector<double> scores;
-        scores.reserve(texts.size());
+        scores.reserve(texts.length());
 
-        for (size_t i = 0; i < texts.size(); ++i) {
+        // null rows are analyzed as empty texts so scores stay aligned with the table
+        texts.for_each([&](const int64_t i, const std::string_view text, bool) {
             if (g_interrupted) {
                 std::cout << "\nProcess interrupted by user at row " << i << std::endl;
-                break;
+                return false;
             }
 
             std::cout << "--------------------------------" << std::endl;
             std::cout << "Processing row " << i + 1 << std::endl;
 
-            double score = analyze_text(llama, texts[i], n_ctx);
+            double score = analyze(text);
             std::cout << "DISCREPANCY: " << score << std::endl;
             scores.push_back(score);
-        }
+            return true;
+        });
         std::cout << std::endl;
 
         if (!scores.empty()) {
@@ -162,13 +267,13 @@ int main(const int argc, char * argv[]) {
         if (std::string input_text; !read_file_to_string(input_file, input_text)) {
             std::cerr << "Failed to read input file." << std::endl;
         } else {
-            const double discrepancy = analyze_text(llama, input_text, n_ctx);
+            const double discrepancy = analyze(input_text);
             std::cout << "DISCREPANCY: " << std::fixed << std::setprecision(4) << discrepancy << std::endl;
         }
     }
 
-    llama_free(llama.ctx);
-    llama_model_free(llama.model);
+    free_llama(reference);
+    free_llama(llama);
     llama_backend_free();
 
     return 0;
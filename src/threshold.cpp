@@ -2,71 +2,458 @@
 
 #include "../include/io.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <thread>
 
-ThresholdResult find_optimal_threshold(std::shared_ptr<arrow::Table> table,
-                                       const std::string &           score_col,
-                                       const std::string &           label_col,
-                                       double                        beta) {
-    ThresholdResult best_res = { 0.0, 0.0, 0.0, 0.0, 0.0, true };
+namespace {
 
-    auto scores = extract_column_as<double>(table, score_col);
-    auto labels = extract_column_as<int>(table, label_col);
+struct DataPoint {
+    uint64_t key;  // order preserving encoding of the score, see score_to_key
+    bool     is_ai;
+    bool     valid;
+};
 
-    if (scores.size() != labels.size() || scores.empty()) {
-        std::cerr << "Error: Column mismatch or empty data." << std::endl;
-        return best_res;
+struct ScoreGroup {
+    double  score;
+    int64_t n_ai;
+    int64_t n_human;
+};
+
+constexpr uint64_t kSignBit = 0x8000000000000000ULL;
+
+// Map a double to an unsigned key with the same ordering, so it can be radix sorted
+uint64_t score_to_key(double score) {
+    if (score == 0.0) {
+        score = 0.0;  // fold -0.0 into +0.0
     }
+    const auto bits = std::bit_cast<uint64_t>(score);
+    return (bits & kSignBit) ? ~bits : bits | kSignBit;
+}
 
-    size_t n = scores.size();
+double key_to_score(const uint64_t key) {
+    return std::bit_cast<double>((key & kSignBit) ? key & ~kSignBit : ~key);
+}
 
-    struct DataPoint {
-        double score;
-        int    label;
-    };
+// LSD radix sort on 16 bit digits, digits shared by every key are skipped
+void sort_data_points(std::vector<DataPoint> & data) {
+    if (data.size() < 4096) {
+        std::sort(data.begin(), data.end(), [](const DataPoint & a, const DataPoint & b) { return a.key < b.key; });
+        return;
+    }
+
+    constexpr int      kDigitBits = 16;
+    constexpr uint64_t kMask      = (1ULL << kDigitBits) - 1;
 
-    std::vector<DataPoint> data(n);
-    int                    total_ai = 0;
+    std::vector<DataPoint> tmp(data.size());
+    std::vector<size_t>    count(kMask + 1);
+
+    for (int shift = 0; shift < 64; shift += kDigitBits) {
+        std::fill(count.begin(), count.end(), 0);
+        for (const auto & p : data) {
+            count[(p.key >> shift) & kMask]++;
+        }
+
+        if (count[(data[0].key >> shift) & kMask] == data.size()) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (auto & c : count) {
+            const size_t n = c;
+            c              = offset;
+            offset += n;
+        }
 
-    for (size_t i = 0; i < n; ++i) {
-        data[i] = { scores[i], labels[i] };
-        if (labels[i] == 1) {
-            total_ai++;
+        for (const auto & p : data) {
+            tmp[count[(p.key >> shift) & kMask]++] = p;
         }
+        data.swap(tmp);
     }
+}
+
+// Walk the sorted groups once, accumulating the confusion matrix for every distinct threshold
+DirectionReport sweep_groups(const std::vector<ScoreGroup> & groups,
+                             const int64_t                   total_ai,
+                             const int64_t                   total_human,
+                             const double                    beta,
+                             const bool                      lower,
+                             const size_t                    max_curve_points) {
+    DirectionReport report = {
+        { 0.0, 0.0, 0.0, 0.0, 0.0, lower },
+        0.0, 0.0, {}
+    };
 
-    std::sort(data.begin(), data.end(), [](const DataPoint & a, const DataPoint & b) { return a.score < b.score; });
+    const int64_t n = total_ai + total_human;
+    if (n == 0 || groups.empty()) {
+        return report;
+    }
+
+    const size_t n_groups = groups.size();
+    size_t       stride   = 0;
+    if (max_curve_points > 0) {
+        // one point is the (0, 0) anchor, the rest sample every stride-th group and always keep the last one
+        const size_t budget = std::max<size_t>(1, max_curve_points - 1);
+        stride              = (n_groups + budget - 1) / budget;
+        report.curve.reserve((n_groups + stride - 1) / stride + 1);
 
-    int tp = 0;
-    int fp = 0;
-    int fn = total_ai;
+        // nothing is predicted as AI yet: the threshold lies beyond every score
+        const double inf = std::numeric_limits<double>::infinity();
+        report.curve.push_back({ lower ? -inf : inf, 0.0, 0.0, 1.0 });
+    }
 
     const double beta_sq = beta * beta;
 
-    for (size_t i = 0; i < n; ++i) {
-        if (data[i].label == 1) {
-            tp++;
-            fn--;
+    int64_t tp       = 0;
+    int64_t fp       = 0;
+    double  prev_tpr = 0.0;
+    double  prev_fpr = 0.0;
+
+    for (size_t k = 0; k < n_groups; ++k) {
+        const auto & group = groups[lower ? k : n_groups - 1 - k];
+        if (group.n_ai == 0 && group.n_human == 0) {
+            continue;
+        }
+
+        tp += group.n_ai;
+        fp += group.n_human;
+
+        const double precision = static_cast<double>(tp) / static_cast<double>(tp + fp);
+        const double recall    = total_ai > 0 ? static_cast<double>(tp) / static_cast<double>(total_ai) : 0.0;
+        const double fpr       = total_human > 0 ? static_cast<double>(fp) / static_cast<double>(total_human) : 0.0;
+        const double accuracy  = static_cast<double>(tp + (total_human - fp)) / static_cast<double>(n);
+
+        const double numerator   = (1 + beta_sq) * (precision * recall);
+        const double denominator = (beta_sq * precision) + recall;
+        const double f_score     = (denominator > 0) ? (numerator / denominator) : 0.0;
+
+        if (f_score > report.best.f_score) {
+            report.best.threshold = group.score;
+            report.best.f_score   = f_score;
+            report.best.precision = precision;
+            report.best.recall    = recall;
+            report.best.accuracy  = accuracy;
+        }
+
+        // trapezoidal ROC area and step-wise average precision
+        report.roc_auc += (fpr - prev_fpr) * (recall + prev_tpr) / 2.0;
+        report.pr_auc += (recall - prev_tpr) * precision;
+        prev_tpr = recall;
+        prev_fpr = fpr;
+
+        if (stride > 0 && ((k + 1) % stride == 0 || k == n_groups - 1)) {
+            report.curve.push_back({ group.score, fpr, recall, precision });
+        }
+    }
+
+    // both areas need positives and negatives to be meaningful
+    if (total_ai == 0 || total_human == 0) {
+        report.roc_auc = std::numeric_limits<double>::quiet_NaN();
+        report.pr_auc  = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    return report;
+}
+
+double quantile(std::vector<double> & values, const double q) {
+    if (values.empty()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    std::sort(values.begin(), values.end());
+    const double pos  = q * static_cast<double>(values.size() - 1);
+    const auto   lo   = static_cast<size_t>(std::floor(pos));
+    const auto   hi   = std::min(lo + 1, values.size() - 1);
+    const double frac = pos - static_cast<double>(lo);
+    return values[lo] + (values[hi] - values[lo]) * frac;
+}
+
+ConfidenceInterval percentile_interval(std::vector<double> & values, const double confidence) {
+    // resamples that drew a single class have an undefined AUC
+    std::erase_if(values, [](const double v) { return std::isnan(v); });
+
+    const double alpha = (1.0 - confidence) / 2.0;
+    return { quantile(values, alpha), quantile(values, 1.0 - alpha) };
+}
+
+// Resample rows with replacement without re-sorting: every row already knows its group,
+// so a resample only redistributes counts over the groups of the point estimate
+void run_bootstrap(const std::vector<uint32_t> &   row_codes,
+                   const std::vector<ScoreGroup> & groups,
+                   const bool                      lower,
+                   const EvaluationOptions &       options,
+                   ColumnEvaluation &              eval) {
+    const int n_resamples = options.n_bootstrap;
+
+    std::vector<double> thresholds(n_resamples);
+    std::vector<double> f_scores(n_resamples);
+    std::vector<double> roc_aucs(n_resamples);
+
+    int n_threads = options.n_threads > 0 ? options.n_threads : static_cast<int>(std::thread::hardware_concurrency());
+    n_threads     = std::clamp(n_threads, 1, n_resamples);
+
+    std::atomic<int> next_resample(0);
+
+    auto worker = [&]() {
+        std::vector<ScoreGroup>               weighted(groups);
+        std::uniform_int_distribution<size_t> pick_row(0, row_codes.size() - 1);
+
+        for (int r = next_resample++; r < n_resamples; r = next_resample++) {
+            // seeding per resample keeps results independent of the thread count
+            std::mt19937_64 rng(options.seed + static_cast<uint64_t>(r));
+
+            for (auto & group : weighted) {
+                group.n_ai    = 0;
+                group.n_human = 0;
+            }
+
+            int64_t total_ai = 0;
+            for (size_t i = 0; i < row_codes.size(); ++i) {
+                const uint32_t code  = row_codes[pick_row(rng)];
+                auto &         group = weighted[code >> 1];
+                if (code & 1) {
+                    group.n_ai++;
+                    total_ai++;
+                } else {
+                    group.n_human++;
+                }
+            }
+            const auto total_human = static_cast<int64_t>(row_codes.size()) - total_ai;
+
+            const auto report = sweep_groups(weighted, total_ai, total_human, options.beta, lower, 0);
+            thresholds[r]     = report.best.threshold;
+            f_scores[r]       = report.best.f_score;
+            roc_aucs[r]       = report.roc_auc;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads);
+    for (int t = 0; t < n_threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    for (auto & w : workers) {
+        w.join();
+    }
+
+    eval.n_bootstrap  = n_resamples;
+    eval.threshold_ci = percentile_interval(thresholds, options.confidence);
+    eval.f_score_ci   = percentile_interval(f_scores, options.confidence);
+    eval.roc_auc_ci   = percentile_interval(roc_aucs, options.confidence);
+}
+
+void write_json_string(std::ostream & os, const std::string & value) {
+    os << '"';
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            // control characters must be escaped as \u00XX
+            constexpr char kHex[] = "0123456789abcdef";
+            os << "\\u00" << kHex[(c >> 4) & 0xF] << kHex[c & 0xF];
         } else {
-            fp++;
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+void write_json_number(std::ostream & os, const double value) {
+    if (std::isfinite(value)) {
+        os << value;
+    } else {
+        os << "null";
+    }
+}
+
+void write_json_interval(std::ostream & os, const ConfidenceInterval & ci) {
+    os << '[';
+    write_json_number(os, ci.lower);
+    os << ", ";
+    write_json_number(os, ci.upper);
+    os << ']';
+}
+
+template <typename Getter> void write_json_curve_array(std::ostream & os, const std::vector<CurvePoint> & curve, Getter get) {
+    os << '[';
+    for (size_t i = 0; i < curve.size(); ++i) {
+        if (i > 0) {
+            os << ", ";
+        }
+        write_json_number(os, get(curve[i]));
+    }
+    os << ']';
+}
+
+void write_json_direction(std::ostream & os, const DirectionReport & report) {
+    os << "{\n";
+    os << "      \"threshold\": ";
+    write_json_number(os, report.best.threshold);
+    os << ",\n      \"f_score\": ";
+    write_json_number(os, report.best.f_score);
+    os << ",\n      \"precision\": ";
+    write_json_number(os, report.best.precision);
+    os << ",\n      \"recall\": ";
+    write_json_number(os, report.best.recall);
+    os << ",\n      \"accuracy\": ";
+    write_json_number(os, report.best.accuracy);
+    os << ",\n      \"roc_auc\": ";
+    write_json_number(os, report.roc_auc);
+    os << ",\n      \"pr_auc\": ";
+    write_json_number(os, report.pr_auc);
+    os << ",\n      \"curve\": {\n        \"threshold\": ";
+    write_json_curve_array(os, report.curve, [](const CurvePoint & p) { return p.threshold; });
+    os << ",\n        \"fpr\": ";
+    write_json_curve_array(os, report.curve, [](const CurvePoint & p) { return p.fpr; });
+    os << ",\n        \"tpr\": ";
+    write_json_curve_array(os, report.curve, [](const CurvePoint & p) { return p.tpr; });
+    os << ",\n        \"precision\": ";
+    write_json_curve_array(os, report.curve, [](const CurvePoint & p) { return p.precision; });
+    os << "\n      }\n    }";
+}
+
+}  // namespace
+
+std::vector<ColumnEvaluation> evaluate_score_columns(std::shared_ptr<arrow::Table>    table,
+                                                     const std::vector<std::string> & score_cols,
+                                                     const std::string &              label_col,
+                                                     const EvaluationOptions &        options) {
+    std::vector<ColumnEvaluation> evaluations;
+
+    ColumnView<int64_t> labels;  // int64 is the usual Parquet label type, read without a cast
+    if (!make_column_view(table, label_col, labels) || labels.empty()) {
+        std::cerr << "Error: Label column '" << label_col << "' is missing or empty." << std::endl;
+        return evaluations;
+    }
+
+    for (const auto & score_col : score_cols) {
+        ColumnView<double> scores;
+        if (!make_column_view(table, score_col, scores) || scores.length() != labels.length()) {
+            std::cerr << "Error: Column mismatch or empty data for '" << score_col << "'." << std::endl;
+            continue;
+        }
+
+        // fill the sort buffer straight from the Arrow chunks, rows with a null label or a null/NaN score are dropped
+        std::vector<DataPoint> data(scores.length());
+        labels.for_each([&](const int64_t row, const int64_t label, const bool valid) {
+            data[row].is_ai = label == 1;
+            data[row].valid = valid;
+        });
+        scores.for_each([&](const int64_t row, const double score, const bool valid) {
+            data[row].key = valid ? score_to_key(score) : 0;
+            data[row].valid &= valid && !std::isnan(score);
+        });
+        std::erase_if(data, [](const DataPoint & p) { return !p.valid; });
+
+        if (data.size() < static_cast<size_t>(scores.length())) {
+            std::cerr << "Warning: Skipping " << scores.length() - static_cast<int64_t>(data.size())
+                      << " rows with null labels or null/NaN scores in '" << score_col << "'" << std::endl;
+        }
+        if (data.empty()) {
+            std::cerr << "Error: No valid scores in '" << score_col << "'." << std::endl;
+            continue;
+        }
+
+        sort_data_points(data);
+
+        // collapse tied scores, a threshold can not separate them
+        std::vector<ScoreGroup> groups;
+        std::vector<uint32_t>   row_codes;
+        const bool              bootstrap = options.n_bootstrap > 0;
+        if (bootstrap) {
+            row_codes.reserve(data.size());
+        }
+
+        int64_t total_ai = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (i == 0 || data[i].key != data[i - 1].key) {
+                groups.push_back({ key_to_score(data[i].key), 0, 0 });
+            }
+            if (data[i].is_ai) {
+                groups.back().n_ai++;
+                total_ai++;
+            } else {
+                groups.back().n_human++;
+            }
+            if (bootstrap) {
+                row_codes.push_back(static_cast<uint32_t>((groups.size() - 1) << 1) | (data[i].is_ai ? 1U : 0U));
+            }
         }
+        const auto total_human = static_cast<int64_t>(data.size()) - total_ai;
 
-        const double precision = (tp + fp) > 0 ? (double) tp / (tp + fp) : 0.0;
-        const double recall    = total_ai > 0 ? (double) tp / total_ai : 0.0;
+        // the sorted rows are no longer needed, release them before bootstrapping
+        const auto n_rows = static_cast<int64_t>(data.size());
+        std::vector<DataPoint>().swap(data);
+
+        if (total_ai == 0 || total_human == 0) {
+            std::cerr << "Warning: '" << score_col << "' has only one class, AUC is undefined" << std::endl;
+        }
+
+        ColumnEvaluation eval = {};
+        eval.score_col        = score_col;
+        eval.n_rows           = n_rows;
+        eval.n_ai             = total_ai;
+
+        eval.lower  = sweep_groups(groups, total_ai, total_human, options.beta, true, options.max_curve_points);
+        eval.higher = sweep_groups(groups, total_ai, total_human, options.beta, false, options.max_curve_points);
+
+        if (bootstrap) {
+            if (groups.size() > (std::numeric_limits<uint32_t>::max() >> 1)) {
+                std::cerr << "Warning: Too many distinct scores for bootstrap in '" << score_col << "'" << std::endl;
+            } else {
+                const bool lower = &eval.best_direction() == &eval.lower;
+                run_bootstrap(row_codes, groups, lower, options, eval);
+            }
+        }
+
+        evaluations.push_back(std::move(eval));
+    }
+
+    return evaluations;
+}
+
+bool save_evaluation_report(const std::string &                   out_path,
+                            const std::vector<ColumnEvaluation> & evaluations,
+                            const EvaluationOptions &             options) {
+    std::ofstream out(out_path, std::ios::out | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error creating report file: " << out_path << std::endl;
+        return false;
+    }
 
-        double numerator   = (1 + beta_sq) * (precision * recall);
-        double denominator = (beta_sq * precision) + recall;
+    out << std::setprecision(10);
+    out << "{\n  \"beta\": " << options.beta << ",\n  \"confidence\": " << options.confidence
+        << ",\n  \"columns\": [\n";
 
-        const double f_score = (denominator > 0) ? (numerator / denominator) : 0.0;
+    for (size_t i = 0; i < evaluations.size(); ++i) {
+        const auto & eval = evaluations[i];
 
-        if (f_score > best_res.f_score) {
-            best_res.f_score         = f_score;
-            best_res.precision       = precision;
-            best_res.recall          = recall;
-            best_res.threshold       = data[i].score;
-            best_res.is_lower_better = true;
+        out << "  {\n    \"score_col\": ";
+        write_json_string(out, eval.score_col);
+        out << ",\n    \"n_rows\": " << eval.n_rows << ",\n    \"n_ai\": " << eval.n_ai;
+        out << ",\n    \"best_direction\": \"" << (eval.best_direction().best.is_lower_better ? "lower" : "higher")
+            << "\"";
+        out << ",\n    \"n_bootstrap\": " << eval.n_bootstrap;
+        if (eval.n_bootstrap > 0) {
+            out << ",\n    \"threshold_ci\": ";
+            write_json_interval(out, eval.threshold_ci);
+            out << ",\n    \"f_score_ci\": ";
+            write_json_interval(out, eval.f_score_ci);
+            out << ",\n    \"roc_auc_ci\": ";
+            write_json_interval(out, eval.roc_auc_ci);
         }
+        out << ",\n    \"lower\": ";
+        write_json_direction(out, eval.lower);
+        out << ",\n    \"higher\": ";
+        write_json_direction(out, eval.higher);
+        out << "\n  }" << (i + 1 < evaluations.size() ? "," : "") << "\n";
     }
 
-    return best_res;
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
 }
@@ -1,8 +1,14 @@
 #include "../include/utils.h"
 
+#include <cstring>
 #include <iostream>
 
-bool setup_llama(LlamaState & llama, const std::string & model_path, bool gpu, int n_ctx, int n_batch) {
+bool setup_llama(LlamaState &        llama,
+                 const std::string & model_path,
+                 const bool          gpu,
+                 const int           n_ctx,
+                 const int           n_batch,
+                 const int           n_threads) {
     auto mparams = llama_model_default_params();
 
     if (gpu) {
@@ -23,10 +29,43 @@ bool setup_llama(LlamaState & llama, const std::string & model_path, bool gpu, i
     cparams.n_batch    = n_batch;
     cparams.embeddings = true;
 
+    if (n_threads > 0) {
+        cparams.n_threads       = n_threads;
+        cparams.n_threads_batch = n_threads;
+    }
+
     llama.ctx = llama_init_from_model(llama.model, cparams);
     return (llama.ctx != nullptr);
 }
 
+void free_llama(LlamaState & llama) {
+    if (llama.ctx) {
+        llama_free(llama.ctx);
+    }
+    if (llama.model) {
+        llama_model_free(llama.model);
+    }
+    llama = {};
+}
+
+bool vocabs_match(const llama_vocab * a, const llama_vocab * b) {
+    const int n_tokens = llama_vocab_n_tokens(a);
+    if (n_tokens != llama_vocab_n_tokens(b) || llama_vocab_type(a) != llama_vocab_type(b)) {
+        return false;
+    }
+
+    if (llama_vocab_bos(a) != llama_vocab_bos(b) || llama_vocab_eos(a) != llama_vocab_eos(b)) {
+        return false;
+    }
+
+    for (llama_token id = 0; id < n_tokens; id++) {
+        if (std::strcmp(llama_vocab_get_text(a, id), llama_vocab_get_text(b, id)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void custom_log(ggml_log_level level, const char * text, void * user_data) {
     if (level == GGML_LOG_LEVEL_ERROR) {
         fprintf(stderr, "%s", text);